@@ -13,6 +13,8 @@
 #include <infos/util/math.h>
 #include <infos/util/printf.h>
 
+#include "trace.h"
+
 using namespace infos::kernel;
 using namespace infos::mm;
 using namespace infos::util;
@@ -153,6 +155,8 @@ class BuddyPageAllocator : public PageAllocatorAlgorithm
 			return *block_pointer;
 		}
 
+		TRACE(TRACE_CAT_MM, TRACE_MM_SPLIT, source_order, sys.mm().pgalloc().pgd_to_pfn(*block_pointer), 0);
+
 		// Get the block's buddy at one level lower than the current one.
 		PageDescriptor *block = *block_pointer;
 		PageDescriptor *buddy = *block_pointer + pages_per_block(source_order - 1);
@@ -192,6 +196,8 @@ class BuddyPageAllocator : public PageAllocatorAlgorithm
 			return block_pointer;
 		};
 
+		TRACE(TRACE_CAT_MM, TRACE_MM_MERGE, source_order, sys.mm().pgalloc().pgd_to_pfn(*block_pointer), 0);
+
 		// Get the block's buddy at the current level.
 		PageDescriptor *block = *block_pointer;
 		PageDescriptor *buddy = buddy_of(*block_pointer, source_order);
@@ -245,6 +251,7 @@ class BuddyPageAllocator : public PageAllocatorAlgorithm
 		{
 			PageDescriptor *free_block = _free_areas[order];
 			remove_block(free_block, order);
+			TRACE(TRACE_CAT_MM, TRACE_MM_ALLOC, order, sys.mm().pgalloc().pgd_to_pfn(free_block), 0);
 			return free_block;
 		}
 
@@ -272,11 +279,13 @@ class BuddyPageAllocator : public PageAllocatorAlgorithm
 			if (block)
 			{
 				remove_block(block, order);
+				TRACE(TRACE_CAT_MM, TRACE_MM_ALLOC, order, sys.mm().pgalloc().pgd_to_pfn(block), 0);
 				return block;
 			}
 		}
 
 		// If block cannot be allocated, return NULL.
+		TRACE(TRACE_CAT_MM, TRACE_MM_ALLOC, order, (uint64_t)-1, 0);
 		return NULL;
 	}
 
@@ -292,6 +301,8 @@ class BuddyPageAllocator : public PageAllocatorAlgorithm
 		// illegal to free page 1 in order-1.
 		assert(is_correct_alignment_for_order(pgd, order));
 
+		TRACE(TRACE_CAT_MM, TRACE_MM_FREE, order, sys.mm().pgalloc().pgd_to_pfn(pgd), 0);
+
 		// Insert the block into the free list.
 		insert_block(pgd, order);
 
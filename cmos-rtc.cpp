@@ -7,19 +7,285 @@
  * STUDENT NUMBER: s1752778
  */
 #include <infos/drivers/timer/rtc.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/irq.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/process.h>
+#include <infos/kernel/thread.h>
+#include <infos/mm/mm.h>
+#include <infos/util/cmdline.h>
+#include <infos/util/event.h>
 #include <infos/util/lock.h>
+#include <infos/util/time.h>
 #include <arch/x86/pio.h>
+#include <arch/x86/x86-arch.h>
+#include <arch/x86/drivers/ioapic.h>
 
+#include "percpu.h"
+#include "rtc-epoch.h"
+#include "seqcount.h"
+#include "time-page.h"
+#include "trace.h"
+
+using namespace infos::kernel;
 using namespace infos::drivers;
+using namespace infos::mm;
 using namespace infos::drivers::timer;
 using namespace infos::util;
 using namespace infos::arch::x86;
+using namespace infos::arch::x86::drivers;
+
+ComponentLog rtc_log(syslog, "rtc");
+
+phys_addr_t time_page_phys;
+
+// Profiler settings, from the kernel command-line.  A rate of zero leaves the profiler off.
+static unsigned int profile_hz;
+static unsigned int profile_seconds = 10;
+static unsigned int profile_granularity = 64;
+
+static unsigned int parse_unsigned(const char *value)
+{
+      unsigned int result = 0;
+      while (*value >= '0' && *value <= '9')
+      {
+            result = (result * 10) + (*value++ - '0');
+      }
+      return result;
+}
+
+RegisterCmdLineArgument(RTCProfileHz, "rtc.profile-hz")
+{
+      profile_hz = parse_unsigned(value);
+}
+
+RegisterCmdLineArgument(RTCProfileSeconds, "rtc.profile-seconds")
+{
+      profile_seconds = parse_unsigned(value);
+}
+
+RegisterCmdLineArgument(RTCProfileGranularity, "rtc.profile-granularity")
+{
+      profile_granularity = parse_unsigned(value);
+}
+
+/**
+ * A sampling profiler, driven by the RTC periodic interrupt.  Each tick records the interrupted
+ * instruction pointer and thread into a per-CPU buffer, which is periodically drained into a
+ * histogram of code regions, and a count of samples per thread.
+ */
+class SamplingProfiler
+{
+    public:
+      /**
+       * Constructs a new, empty, profiler.
+       */
+      SamplingProfiler() : _granularity_shift(6), _total(0), _unbinned(0)
+      {
+            for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+            {
+                  _buffers[cpu].head = 0;
+                  _buffers[cpu].tail = 0;
+                  _buffers[cpu].dropped = 0;
+            }
+
+            for (unsigned int i = 0; i < ARRAY_SIZE(_histogram); i++)
+            {
+                  _histogram[i].key = 0;
+                  _histogram[i].count = 0;
+            }
+
+            for (unsigned int i = 0; i < ARRAY_SIZE(_threads); i++)
+            {
+                  _threads[i].key = 0;
+                  _threads[i].count = 0;
+            }
+      }
+
+      /**
+       * Sets the size of the code regions that samples are binned into.  Samples anywhere in
+       * a region count towards the same bin, so that a hot function shows up as one (or a few)
+       * bins, rather than one per instruction.
+       * @param bytes The region size, which is rounded down to a power of two.
+       */
+      void set_granularity(unsigned int bytes)
+      {
+            _granularity_shift = 0;
+            while ((2u << _granularity_shift) <= bytes)
+            {
+                  _granularity_shift++;
+            }
+      }
+
+      /**
+       * Records a sample.  Called from interrupt context, so this must be cheap: if the buffer
+       * is full, the sample is dropped (and counted).
+       * @param ip The interrupted instruction pointer.
+       * @param thread The thread that was running when the tick arrived.
+       */
+      void record(uintptr_t ip, const Thread *thread)
+      {
+            SampleBuffer &buffer = _buffers[current_cpu()];
+
+            if (buffer.head - buffer.tail == ARRAY_SIZE(buffer.samples))
+            {
+                  buffer.dropped++;
+                  return;
+            }
+
+            Sample &sample = buffer.samples[buffer.head % ARRAY_SIZE(buffer.samples)];
+            sample.ip = ip;
+            sample.thread = thread;
+            buffer.head++;
+      }
+
+      /**
+       * Moves every buffered sample into the histogram.
+       */
+      void drain()
+      {
+            for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+            {
+                  SampleBuffer &buffer = _buffers[cpu];
+
+                  while (buffer.tail != buffer.head)
+                  {
+                        const Sample &sample = buffer.samples[buffer.tail % ARRAY_SIZE(buffer.samples)];
+
+                        _total++;
+                        if (!aggregate(_histogram, ARRAY_SIZE(_histogram), (sample.ip >> _granularity_shift) << _granularity_shift))
+                        {
+                              _unbinned++;
+                        }
+
+                        aggregate(_threads, ARRAY_SIZE(_threads), (uintptr_t)sample.thread);
+                        buffer.tail++;
+                  }
+            }
+      }
+
+      /**
+       * Logs the hottest code regions, which can be resolved to functions on the host with
+       * addr2line, and the threads that were sampled most.  This formats many log lines, so
+       * must not be called from interrupt context.
+       */
+      void report()
+      {
+            uint64_t dropped = 0;
+            for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+            {
+                  dropped += _buffers[cpu].dropped;
+            }
+
+            rtc_log.messagef(LogLevel::INFO, "PROFILE: samples=%lu dropped=%lu unbinned=%lu granularity=%u", _total, dropped, _unbinned, 1u << _granularity_shift);
+
+            rtc_log.message(LogLevel::INFO, "PROFILE: hottest code regions");
+            report_bins(_histogram, ARRAY_SIZE(_histogram));
+
+            rtc_log.message(LogLevel::INFO, "PROFILE: most sampled threads");
+            report_bins(_threads, ARRAY_SIZE(_threads));
+      }
+
+    private:
+      static const unsigned int report_entries = 16;
+
+      struct Sample
+      {
+            uintptr_t ip;
+            const Thread *thread;
+      };
+
+      // A single-producer (the tick on this CPU), single-consumer (the drain) ring of samples.
+      // It holds a full second of samples at the fastest rate, as it is drained once a second.
+      struct SampleBuffer
+      {
+            Sample samples[8192];
+            uint64_t head;
+            uint64_t tail;
+            uint64_t dropped;
+      };
+
+      // An open-addressed hash table bin, keyed by code region or thread.
+      struct HistogramBin
+      {
+            uintptr_t key;
+            uint64_t count;
+      };
+
+      SampleBuffer _buffers[MAX_CPUS];
+      HistogramBin _histogram[1024];
+      HistogramBin _threads[64];
+      unsigned int _granularity_shift;
+      uint64_t _total;
+      uint64_t _unbinned;
+
+      /**
+       * Logs the largest bins of a table, largest first.  Reported bins are cleared, so the
+       * table is consumed by the report.
+       */
+      void report_bins(HistogramBin *bins, unsigned int nr_bins)
+      {
+            for (unsigned int rank = 0; rank < report_entries; rank++)
+            {
+                  HistogramBin *hottest = NULL;
+                  for (unsigned int i = 0; i < nr_bins; i++)
+                  {
+                        if (bins[i].count && (!hottest || bins[i].count > hottest->count))
+                        {
+                              hottest = &bins[i];
+                        }
+                  }
+
+                  if (!hottest)
+                  {
+                        break;
+                  }
+
+                  rtc_log.messagef(LogLevel::INFO, "  %2u: %016lx %lu (%lu%%)", rank, hottest->key, hottest->count, (hottest->count * 100) / _total);
+                  hottest->count = 0;
+            }
+      }
+
+      /**
+       * Counts a sample in a table of bins.  Samples that cannot find a bin after a bounded
+       * probe are not counted, rather than growing the table.
+       * @return Returns TRUE if the sample was counted.
+       */
+      static bool aggregate(HistogramBin *bins, unsigned int nr_bins, uintptr_t key)
+      {
+            unsigned int slot = (key * 0x9E3779B97F4A7C15ull) >> 32;
+
+            for (unsigned int probe = 0; probe < 16; probe++)
+            {
+                  HistogramBin &bin = bins[(slot + probe) % nr_bins];
+
+                  if (bin.count == 0 || bin.key == key)
+                  {
+                        bin.key = key;
+                        bin.count++;
+                        return true;
+                  }
+            }
+
+            return false;
+      }
+};
 
 class CMOSRTC : public RTC
 {
     public:
       static const DeviceClass CMOSRTCDeviceClass;
 
+      /**
+       * Constructs a new instance of the CMOS RTC.  No cached reading is valid until init()
+       * has read the hardware.
+       */
+      CMOSRTC() : _profile_remaining(0), _profile_report_pending(false), _trace_dump_remaining(0), _trace_dump_pending(false), _worker(NULL), _time_page(NULL), _last_update_cycles(0), _last_update_epoch(0), _sample_seq(0)
+      {
+            _sample.epoch_seconds = 0;
+            _sample.runtime_ns = 0;
+      }
+
       const DeviceClass &device_class() const override
       {
             return CMOSRTCDeviceClass;
@@ -34,6 +300,24 @@ class CMOSRTC : public RTC
             cmos_data = 0x71
       };
 
+      enum
+      {
+            rtc_irq = 8,
+            nmi_disable = 0x80,
+            register_a_rate_mask = 0x0F,
+            register_b_pie = 0x40,
+            register_b_uie = 0x10,
+            register_c_pf = 0x40,
+            register_c_uf = 0x10
+      };
+
+      // The century register is not part of the original MC146818 register set, but most
+      // firmware provides it here (as advertised by the ACPI FADT century field).
+      enum
+      {
+            century_register = 0x32
+      };
+
       int get_update_in_progress_flag()
       {
             __outb(cmos_address, 0xA);
@@ -59,6 +343,21 @@ class CMOSRTC : public RTC
       }
 
       RTCTimePoint get_tp()
+      {
+            UniqueIRQLock l;
+
+            // Note: This uses the "read registers until you get the same values twice in a row" technique
+            //       to avoid getting dodgy/inconsistent values due to RTC updates
+
+            while (get_update_in_progress_flag()); // Make sure an update isn't in progress
+            return read_registers();
+      }
+
+      /**
+       * Reads the raw (undecoded) date & time registers.  The caller must ensure that an update is
+       * not in progress.
+       */
+      RTCTimePoint read_registers()
       {
             unsigned char second;
             unsigned char minute;
@@ -67,12 +366,6 @@ class CMOSRTC : public RTC
             unsigned char month;
             unsigned int year;
 
-            UniqueIRQLock l;
-
-            // Note: This uses the "read registers until you get the same values twice in a row" technique
-            //       to avoid getting dodgy/inconsistent values due to RTC updates
-
-            while (get_update_in_progress_flag()); // Make sure an update isn't in progress
             second = get_RTC_register(0x00);
             minute = get_RTC_register(0x02);
             hour = get_RTC_register(0x04);
@@ -94,6 +387,137 @@ class CMOSRTC : public RTC
             return tp;
       }
 
+      /**
+       * Initialises the RTC, by taking the first reading of the hardware clock, and then
+       * enabling the update-ended interrupt so that the reading is refreshed every second.
+       * @return Returns TRUE if the device was successfully initialised.
+       */
+      bool init(DeviceManager &dm) override
+      {
+            resync();
+
+            // Allocate the page through which the time is published to user space.  It stays
+            // invalid until the update interrupt has calibrated the cycle counter.
+            PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(0);
+            if (pgd)
+            {
+                  _time_page = (TimePage *)sys.mm().pgalloc().pgd_to_vpa(pgd);
+                  _time_page->seq = 0;
+                  _time_page->valid = 0;
+                  time_page_phys = sys.mm().pgalloc().pgd_to_pfn(pgd) << 12;
+            }
+            else
+            {
+                  rtc_log.message(LogLevel::WARNING, "Unable to allocate time page");
+            }
+
+            // If the interrupt cannot be routed, the RTC still works -- the cached reading is
+            // just refreshed from the read path, every resync interval.
+            IOAPIC *ioapic;
+            if (!dm.try_get_device_by_class(IOAPIC::IOAPICDeviceClass, ioapic))
+            {
+                  rtc_log.message(LogLevel::WARNING, "Unable to locate IOAPIC -- update interrupt disabled");
+                  return true;
+            }
+
+            IRQ *irq = x86arch.irq_manager().allocate_irq();
+            if (!irq)
+            {
+                  rtc_log.message(LogLevel::WARNING, "Unable to allocate IRQ -- update interrupt disabled");
+                  return true;
+            }
+
+            irq->attach(rtc_irq_handler, this);
+            ioapic->register_interrupt(rtc_irq, irq);
+
+            enable_update_interrupt();
+
+            // The profile is only drained and reported as its seconds count down, so a
+            // zero-length profile would leave the periodic interrupt running forever.
+            if (profile_hz && profile_seconds == 0)
+            {
+                  rtc_log.message(LogLevel::WARNING, "rtc.profile-seconds must be non-zero -- profiler disabled");
+            }
+            else if (profile_hz)
+            {
+                  if (start_worker())
+                  {
+                        _profiler.set_granularity(profile_granularity);
+                        _profile_remaining = profile_seconds;
+                        enable_periodic_interrupt(profile_hz);
+                  }
+                  else
+                  {
+                        rtc_log.message(LogLevel::WARNING, "Unable to create worker thread -- profiler disabled");
+                  }
+            }
+
+            if (trace_dump_after)
+            {
+                  if (start_worker())
+                  {
+                        _trace_dump_remaining = trace_dump_after;
+                  }
+                  else
+                  {
+                        rtc_log.message(LogLevel::WARNING, "Unable to create worker thread -- trace dump disabled");
+                  }
+            }
+
+            return true;
+      }
+
+      /**
+       * Enables the periodic interrupt.  The RTC can only divide its 32.768kHz base clock by
+       * powers of two, so the rate is rounded down to the nearest of 2Hz, 4Hz, ..., 8192Hz
+       * (and clamped to that range).
+       * @param hz The requested interrupt rate.
+       * @return Returns the rate that was actually programmed.
+       */
+      unsigned int enable_periodic_interrupt(unsigned int hz)
+      {
+            // A rate select of r gives 32768 >> (r - 1) Hz; the valid selects are 3 to 15.
+            unsigned int rate = 15;
+            while (rate > 3 && (32768u >> (rate - 2)) <= hz)
+            {
+                  rate--;
+            }
+
+            UniqueIRQLock l;
+
+            __outb(cmos_address, nmi_disable | 0xA);
+            unsigned char registerA = __inb(cmos_data);
+            __outb(cmos_address, nmi_disable | 0xA);
+            __outb(cmos_data, (registerA & ~register_a_rate_mask) | rate);
+
+            __outb(cmos_address, nmi_disable | 0xB);
+            unsigned char registerB = __inb(cmos_data);
+            __outb(cmos_address, nmi_disable | 0xB);
+            __outb(cmos_data, registerB | register_b_pie);
+
+            get_RTC_register(0xC);
+
+            unsigned int actual = 32768u >> (rate - 1);
+            rtc_log.messagef(LogLevel::INFO, "Periodic interrupt enabled at %uHz", actual);
+            return actual;
+      }
+
+      /**
+       * Disables the periodic interrupt.
+       */
+      void disable_periodic_interrupt()
+      {
+            UniqueIRQLock l;
+
+            __outb(cmos_address, nmi_disable | 0xB);
+            unsigned char registerB = __inb(cmos_data);
+            __outb(cmos_address, nmi_disable | 0xB);
+            __outb(cmos_data, registerB & ~register_b_pie);
+
+            // Re-enable NMIs, by selecting a register without the NMI-disable bit.
+            get_RTC_register(0xC);
+      }
+
       /**
 	 * Interrogates the RTC to read the current date & time.
 	 * @param tp Populates the tp structure with the current data & time, as
@@ -101,9 +525,307 @@ class CMOSRTC : public RTC
 	 */
       void read_timepoint(RTCTimePoint &tp) override
       {
-            // FILL IN THIS METHOD - WRITE HELPER METHODS IF NECESSARY
-            unsigned char registerB;
+            // Resynchronise with the hardware if the cached reading has gone stale (i.e. the update
+            // interrupt is not firing).  Otherwise, the current time is the cached epoch plus the time
+            // that has elapsed since it was read.
+            Sample sample = read_sample();
+            uint64_t now = sys.runtime().count();
+
+            if (now - sample.runtime_ns >= resync_interval_ns)
+            {
+                  resync();
+                  read_timepoint(tp);
+                  return;
+            }
+
+            int64_t epoch = sample.epoch_seconds + (int64_t)((now - sample.runtime_ns) / 1000000000ull);
+            TRACE(TRACE_CAT_RTC, TRACE_RTC_READ, 0, epoch, 0);
+
+            tp = rtc_epoch_to_timepoint(epoch);
+      }
+
+    private:
+      // How often (in nanoseconds) the cached wall-clock reading is refreshed from the hardware.
+      static const uint64_t resync_interval_ns = 60ull * 1000000000ull;
+
+      // A hardware reading of the wall clock, and the system runtime at which it was taken.
+      struct Sample
+      {
+            int64_t epoch_seconds;
+            uint64_t runtime_ns;
+      };
+
+      SamplingProfiler _profiler;
+
+      // The number of seconds the profiler has left to run, and whether its report is waiting
+      // to be written by the worker thread.
+      unsigned int _profile_remaining;
+      bool _profile_report_pending;
+
+      // The number of seconds until the trace buffers are dumped (see trace.h), and whether
+      // the dump is waiting to be written by the worker thread.
+      unsigned int _trace_dump_remaining;
+      bool _trace_dump_pending;
+
+      // A kernel thread that does work deferred from the interrupt handler, and the event
+      // used to wake it.
+      Thread *_worker;
+      Event _worker_event;
+
+      /**
+       * Starts the worker thread, if it has not already been started.
+       * @return Returns TRUE if the worker thread is running.
+       */
+      bool start_worker()
+      {
+            if (_worker)
+            {
+                  return true;
+            }
+
+            worker_instance = this;
+
+            _worker = sys.kernel_process().create_thread(ThreadPrivilege::Kernel, (Thread::thread_proc_t)worker_thread_proc, "rtc-worker");
+            if (!_worker)
+            {
+                  return false;
+            }
+
+            _worker->start();
+            return true;
+      }
+
+      // The instance the worker thread serves.
+      static CMOSRTC *worker_instance;
+
+      static void worker_thread_proc()
+      {
+            worker_instance->run_worker();
+      }
+
+      /**
+       * The body of the worker thread: waits to be woken by the interrupt handler, and then
+       * does whatever work has been deferred to it.
+       */
+      void run_worker()
+      {
+            while (true)
+            {
+                  _worker_event.wait();
+
+                  if (__atomic_exchange_n(&_profile_report_pending, false, __ATOMIC_ACQUIRE))
+                  {
+                        _profiler.report();
+                  }
+
+                  // Tracing is stopped before the dump, so that the dump is of the window up to
+                  // the deadline, rather than of the dump's own activity.
+                  if (__atomic_exchange_n(&_trace_dump_pending, false, __ATOMIC_ACQUIRE))
+                  {
+                        trace_set_categories(0);
+                        trace_dump();
+                  }
+            }
+      }
+
+      // The page shared with user space, and the cycle counter and epoch at the last
+      // update-ended interrupt, used to calibrate the cycle counter.
+      TimePage *_time_page;
+      uint64_t _last_update_cycles;
+      int64_t _last_update_epoch;
+
+      // The cached sample, protected by a sequence counter.
+      Sample _sample;
+      uint32_t _sample_seq;
+
+      /**
+       * Takes a consistent copy of the cached sample, without locking.
+       */
+      Sample read_sample() const
+      {
+            Sample sample;
+            uint32_t seq;
+
+            do
+            {
+                  seq = seqcount_read_begin(&_sample_seq);
+                  sample.epoch_seconds = __atomic_load_n(&_sample.epoch_seconds, __ATOMIC_RELAXED);
+                  sample.runtime_ns = __atomic_load_n(&_sample.runtime_ns, __ATOMIC_RELAXED);
+            } while (seqcount_read_retry(&_sample_seq, seq));
+
+            return sample;
+      }
+
+      /**
+       * Publishes a new cached sample.  Writers must be serialised with each other, which they are
+       * by running either in the IRQ handler, or with interrupts disabled.
+       * @param tp The decoded timepoint that was just read from the hardware.
+       */
+      void publish_sample(const RTCTimePoint &tp)
+      {
+            seqcount_write_begin(&_sample_seq);
+            __atomic_store_n(&_sample.epoch_seconds, rtc_timepoint_to_epoch(tp), __ATOMIC_RELAXED);
+            __atomic_store_n(&_sample.runtime_ns, sys.runtime().count(), __ATOMIC_RELAXED);
+            seqcount_write_end(&_sample_seq);
+      }
+
+      /**
+       * Reads the hardware clock, and publishes it as the new cached sample.
+       */
+      void resync()
+      {
+            UniqueIRQLock l;
+
+            RTCTimePoint tp;
+            read_hardware_timepoint(tp);
+            publish_sample(tp);
+      }
+
+      /**
+       * Enables the update-ended interrupt, which fires once a second, just after the RTC has
+       * finished updating its registers.
+       */
+      void enable_update_interrupt()
+      {
+            UniqueIRQLock l;
+
+            __outb(cmos_address, nmi_disable | 0xB);
+            unsigned char registerB = __inb(cmos_data);
+            __outb(cmos_address, nmi_disable | 0xB);
+            __outb(cmos_data, registerB | register_b_uie);
+
+            // Reading register C acknowledges any interrupt that is already pending.
+            get_RTC_register(0xC);
+      }
+
+      // The largest correction (in nanoseconds per second) made to the time page by adjusting
+      // its rate.  Larger errors behind the RTC are stepped; errors ahead are only slewed, as
+      // stepping back would make the time go backwards.
+      static const int64_t time_page_max_slew_ns = 1000000;
+
+      /**
+       * Publishes the time of an update-ended interrupt to the time page.  The RTC updates
+       * exactly once a second, so the number of cycles between two consecutive updates
+       * gives the cycle counter frequency.
+       * @param epoch The wall-clock time of the update, in seconds since the UNIX epoch.
+       * @param cycles The cycle counter, as read at the start of the interrupt.
+       */
+      void publish_time_page(int64_t epoch, uint64_t cycles)
+      {
+            bool calibrated = _last_update_cycles && epoch == _last_update_epoch + 1;
+            uint64_t hz = cycles - _last_update_cycles;
+
+            _last_update_cycles = cycles;
+            _last_update_epoch = epoch;
+
+            if (!_time_page || !calibrated)
+            {
+                  return;
+            }
+
+            seqcount_write_begin(&_time_page->seq);
+
+            // The new base is taken after the write has begun, so any reader that completed with
+            // the old parameters read the cycle counter earlier, and so saw an earlier time.
+            uint64_t base_cycles = read_cycle_counter();
+            int64_t rtc_ns = (epoch * 1000000000ll) + (int64_t)(((unsigned __int128)(base_cycles - cycles) * 1000000000ull) / hz);
+
+            // Continue from where the old parameters have got to, and run fast or slow over the
+            // next second to close the gap to the RTC.
+            int64_t base_ns = rtc_ns;
+            int64_t slew = 0;
+
+            if (_time_page->valid)
+            {
+                  base_ns = time_page_extrapolate(_time_page, base_cycles);
+                  slew = rtc_ns - base_ns;
+
+                  if (slew > time_page_max_slew_ns)
+                  {
+                        base_ns = rtc_ns;
+                        slew = 0;
+                  }
+                  else if (slew < -time_page_max_slew_ns)
+                  {
+                        slew = -time_page_max_slew_ns;
+                  }
+            }
+
+            // Pick the largest shift for which the multiplier still fits in 32 bits.
+            uint64_t ns_per_second = 1000000000ll + slew;
+            uint32_t shift = 32;
+            while (shift > 0 && (ns_per_second << shift) / hz > 0xFFFFFFFFull)
+            {
+                  shift--;
+            }
+
+            __atomic_store_n(&_time_page->base_epoch_ns, base_ns, __ATOMIC_RELAXED);
+            __atomic_store_n(&_time_page->base_cycles, base_cycles, __ATOMIC_RELAXED);
+            __atomic_store_n(&_time_page->mult, (uint32_t)((ns_per_second << shift) / hz), __ATOMIC_RELAXED);
+            __atomic_store_n(&_time_page->shift, shift, __ATOMIC_RELAXED);
+            __atomic_store_n(&_time_page->valid, 1u, __ATOMIC_RELAXED);
+
+            seqcount_write_end(&_time_page->seq);
+      }
+
+      static void rtc_irq_handler(const IRQ *, void *priv)
+      {
+            ((CMOSRTC *)priv)->handle_interrupt();
+      }
+
+      /**
+       * Handles an RTC interrupt.  When an update has just ended, the registers are stable for
+       * (almost) a second, so they can be read once, without waiting on the update-in-progress flag.
+       */
+      void handle_interrupt()
+      {
+            uint64_t cycles = read_cycle_counter();
+
+            // Register C must be read for the RTC to raise any further interrupts.  It also
+            // reports which of the (shared) interrupt sources fired.
+            unsigned char registerC = get_RTC_register(0xC);
+
+            if (registerC & register_c_pf)
+            {
+                  Thread &thread = Thread::current();
+                  _profiler.record(thread.context().native_context->rip, &thread);
+            }
+
+            if (registerC & register_c_uf)
+            {
+                  RTCTimePoint tp = read_registers();
+                  decode_timepoint(tp);
+                  publish_sample(tp);
+                  publish_time_page(rtc_timepoint_to_epoch(tp), cycles);
+
+                  if (_profile_remaining)
+                  {
+                        _profiler.drain();
+
+                        if (--_profile_remaining == 0)
+                        {
+                              disable_periodic_interrupt();
+
+                              __atomic_store_n(&_profile_report_pending, true, __ATOMIC_RELEASE);
+                              _worker_event.trigger();
+                        }
+                  }
+
+                  if (_trace_dump_remaining && --_trace_dump_remaining == 0)
+                  {
+                        __atomic_store_n(&_trace_dump_pending, true, __ATOMIC_RELEASE);
+                        _worker_event.trigger();
+                  }
+            }
+      }
 
+      /**
+       * Interrogates the RTC hardware directly, to read the current date & time.  This is slow, as
+       * it has to wait for any update in progress, and read the registers until they are stable.
+       * @param tp Populates the tp structure with the current date & time.
+       */
+      void read_hardware_timepoint(RTCTimePoint &tp)
+      {
             tp = get_tp();
             RTCTimePoint previous = tp;
 
@@ -113,7 +835,17 @@ class CMOSRTC : public RTC
                   tp = get_tp();
             } while (!tp_eq(tp, previous));
 
-            registerB = get_RTC_register(0xB);
+            decode_timepoint(tp);
+      }
+
+      /**
+       * Decodes a timepoint read from the RTC registers, according to the data mode the
+       * RTC is in (BCD or binary, and 12 or 24 hour clock).
+       * @param tp The raw timepoint to decode in place.
+       */
+      void decode_timepoint(RTCTimePoint &tp)
+      {
+            unsigned char registerB = get_RTC_register(0xB);
 
             // Convert BCD to binary values if necessary
 
@@ -134,11 +866,23 @@ class CMOSRTC : public RTC
                   tp.hours = ((tp.hours & 0x7F) + 12) % 24;
             }
 
-            // Calculate the full (4-digit) year
+            // Calculate the full (4-digit) year, from the century register if it holds a
+            // plausible value, otherwise by assuming the two-digit year lies in 1970-2069.
 
-            tp.year += (tp.year / 100) * 100;
-            if (tp.year < tp.year)
-                  tp.year += 100;
+            unsigned int century = get_RTC_register(century_register);
+            if (!(registerB & 0x04))
+            {
+                  century = (century & 0x0F) + ((century / 16) * 10);
+            }
+
+            if (century >= 19 && century <= 99)
+            {
+                  tp.year += century * 100;
+            }
+            else
+            {
+                  tp.year += tp.year < 70 ? 2000 : 1900;
+            }
       }
 
       // private:
@@ -170,6 +914,8 @@ class CMOSRTC : public RTC
       // 	}
 };
 
+CMOSRTC *CMOSRTC::worker_instance;
+
 const DeviceClass CMOSRTC::CMOSRTCDeviceClass(RTC::RTCDeviceClass, "cmos-rtc");
 
 RegisterDevice(CMOSRTC);
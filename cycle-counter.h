@@ -0,0 +1,16 @@
+/*
+ * CPU Cycle Counter
+ */
+#pragma once
+
+#include <infos/define.h>
+
+/**
+ * Reads the CPU cycle counter.
+ */
+static inline uint64_t read_cycle_counter()
+{
+	uint32_t lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
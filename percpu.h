@@ -0,0 +1,14 @@
+/*
+ * Per-CPU Data
+ */
+#pragma once
+
+/*
+ * The number of CPUs that per-CPU data is kept for.  InfOS only brings up the boot CPU.
+ */
+#define MAX_CPUS 1
+
+/**
+ * Returns the index of the CPU that the caller is running on.
+ */
+static inline unsigned int current_cpu() { return 0; }
@@ -0,0 +1,193 @@
+/*
+ * RTC Timepoint <-> Epoch Time Conversion
+ */
+#pragma once
+
+#include <infos/drivers/timer/rtc.h>
+
+/*
+ * The number of days in the year before the start of each month, for common and leap years.
+ */
+static constexpr unsigned short rtc_days_before_month[2][12] = {
+	{ 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 },
+	{ 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 },
+};
+
+static inline constexpr bool rtc_is_leap_year(int64_t year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/**
+ * Returns the number of leap years in [1, year], for a non-negative year.
+ */
+static inline constexpr int64_t rtc_leap_years_through(int64_t year)
+{
+	return year / 4 - year / 100 + year / 400;
+}
+
+/**
+ * Converts a decoded timepoint into seconds since the UNIX epoch (1970-01-01T00:00:00Z).
+ * @param tp The timepoint to convert.  The year must be the full (four-digit) year.
+ * @return Returns the number of seconds since the epoch.
+ */
+static inline constexpr int64_t rtc_timepoint_to_epoch(const infos::drivers::timer::RTCTimePoint &tp)
+{
+	int64_t days = (tp.year - 1970) * 365
+		+ rtc_leap_years_through(tp.year - 1) - rtc_leap_years_through(1969)
+		+ rtc_days_before_month[rtc_is_leap_year(tp.year)][tp.month - 1]
+		+ (tp.day_of_month - 1);
+
+	return days * 86400 + tp.hours * 3600 + tp.minutes * 60 + tp.seconds;
+}
+
+/**
+ * Converts a decoded timepoint into nanoseconds since the UNIX epoch.
+ */
+static inline constexpr int64_t rtc_timepoint_to_epoch_ns(const infos::drivers::timer::RTCTimePoint &tp)
+{
+	return rtc_timepoint_to_epoch(tp) * 1000000000ll;
+}
+
+/**
+ * Converts seconds since the UNIX epoch into a timepoint.
+ * @param epoch The number of seconds since the epoch.
+ * @return Returns the corresponding timepoint.
+ */
+static inline constexpr infos::drivers::timer::RTCTimePoint rtc_epoch_to_timepoint(int64_t epoch)
+{
+	int64_t days = epoch / 86400;
+	int64_t secs = epoch % 86400;
+	if (secs < 0)
+	{
+		secs += 86400;
+		days--;
+	}
+
+	// Find the year by counting whole 400-year eras (which are always 146097 days long)
+	// from a March 1st, so that the leap day falls at the end of each year.
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned int doe = (unsigned int)(days - era * 146097);
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t year = (int64_t)yoe + era * 400;
+
+	// Convert the March-based day of year into a January-based one, and look up the month.
+	unsigned int doy_march = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	year += doy_march >= 306;
+	bool leap = rtc_is_leap_year(year);
+	unsigned int doy = doy_march >= 306 ? doy_march - 306 : doy_march + 59 + leap;
+
+	// Count the months that start on or before the day, without branching.
+	unsigned int month = 0;
+	for (unsigned int m = 0; m < 12; m++)
+	{
+		month += rtc_days_before_month[leap][m] <= doy;
+	}
+
+	infos::drivers::timer::RTCTimePoint tp = {};
+	tp.seconds = secs % 60;
+	tp.minutes = (secs / 60) % 60;
+	tp.hours = secs / 3600;
+	tp.day_of_month = doy - rtc_days_before_month[leap][month - 1] + 1;
+	tp.month = month;
+	tp.year = year;
+	return tp;
+}
+
+/**
+ * Converts nanoseconds since the UNIX epoch into a timepoint (truncating to the second).
+ */
+static inline constexpr infos::drivers::timer::RTCTimePoint rtc_epoch_ns_to_timepoint(int64_t epoch_ns)
+{
+	int64_t epoch = epoch_ns / 1000000000ll;
+	if (epoch_ns % 1000000000ll < 0)
+	{
+		epoch--;
+	}
+
+	return rtc_epoch_to_timepoint(epoch);
+}
+
+static_assert(rtc_timepoint_to_epoch({ 0, 0, 0, 1, 1, 1970 }) == 0, "epoch conversion is broken");
+static_assert(rtc_timepoint_to_epoch({ 7, 14, 3, 19, 1, 2038 }) == 2147483647, "epoch conversion is broken");
+static_assert(rtc_timepoint_to_epoch({ 0, 0, 0, 29, 2, 2000 }) == 951782400, "epoch conversion is broken");
+static_assert(rtc_epoch_to_timepoint(951782400).month == 2 && rtc_epoch_to_timepoint(951782400).day_of_month == 29, "epoch conversion is broken");
+static_assert(rtc_epoch_to_timepoint(2147483647).year == 2038 && rtc_epoch_to_timepoint(2147483647).hours == 3, "epoch conversion is broken");
+
+/*
+ * The length of a timestamp produced by rtc_format_epoch_batch(): YYYY-MM-DDTHH:MM:SSZ
+ */
+#define RTC_TIMESTAMP_LENGTH 20
+
+/*
+ * The two-digit decimal representations of 0 to 99, back-to-back.
+ */
+static const char rtc_two_digits[] =
+	"00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+/**
+ * Writes the two-digit decimal representation of a number in [0, 99].
+ */
+static inline void rtc_format_two_digits(char *out, unsigned int n)
+{
+	out[0] = rtc_two_digits[n * 2];
+	out[1] = rtc_two_digits[n * 2 + 1];
+}
+
+/**
+ * Formats a batch of epoch times as fixed-width ISO 8601 timestamps.  Each timestamp is
+ * RTC_TIMESTAMP_LENGTH characters, and they are packed back-to-back with no terminators.
+ * Batches are typically sorted log timestamps, many of which fall on the same day, so the
+ * date is only recomputed when the day changes; the time of day is formatted directly from
+ * the seconds into the day.
+ * @param epochs The epoch times (in seconds) to format.  Years must be in [0, 9999].
+ * @param count The number of epoch times.
+ * @param out The output buffer, which must hold count * RTC_TIMESTAMP_LENGTH characters.
+ */
+static inline void rtc_format_epoch_batch(const int64_t *epochs, size_t count, char *out)
+{
+	char date[11];
+	int64_t date_day = 0;
+	bool have_date = false;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		int64_t day = epochs[i] / 86400;
+		int64_t secs = epochs[i] % 86400;
+		if (secs < 0)
+		{
+			day--;
+			secs += 86400;
+		}
+
+		if (!have_date || day != date_day)
+		{
+			infos::drivers::timer::RTCTimePoint tp = rtc_epoch_to_timepoint(day * 86400);
+
+			rtc_format_two_digits(&date[0], tp.year / 100);
+			rtc_format_two_digits(&date[2], tp.year % 100);
+			date[4] = '-';
+			rtc_format_two_digits(&date[5], tp.month);
+			date[7] = '-';
+			rtc_format_two_digits(&date[8], tp.day_of_month);
+			date[10] = 'T';
+
+			date_day = day;
+			have_date = true;
+		}
+
+		char *ts = out + (i * RTC_TIMESTAMP_LENGTH);
+		unsigned int s = (unsigned int)secs;
+
+		__builtin_memcpy(ts, date, sizeof(date));
+		rtc_format_two_digits(&ts[11], s / 3600);
+		ts[13] = ':';
+		rtc_format_two_digits(&ts[14], (s / 60) % 60);
+		ts[16] = ':';
+		rtc_format_two_digits(&ts[17], s % 60);
+		ts[19] = 'Z';
+	}
+}
@@ -0,0 +1,565 @@
+/*
+ * Earliest-Deadline-First Scheduling Algorithm
+ *
+ * Entities with deadline parameters are scheduled by earliest deadline, ahead of every
+ * best-effort entity.  Best-effort entities are scheduled by the round-robin algorithm,
+ * whenever no deadline entity is runnable.
+ */
+#include <infos/kernel/kernel.h>
+#include <infos/util/time.h>
+
+#include "sched-rr.h"
+#include "sched-edf.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+// The maximum number of entities with deadline parameters.
+#define MAX_DEADLINE_ENTITIES 32
+
+// The share of the CPU (in parts per million) that deadline entities may reserve between them.
+// The remainder is left for best-effort entities, and for the accounting granularity of the
+// scheduler tick.
+#define MAX_DEADLINE_UTILISATION 950000
+
+/**
+ * The scheduling state of an entity with deadline parameters.
+ */
+struct DeadlineEntity
+{
+	SchedulingEntity *entity;
+
+	// The entity's parameters.
+	uint64_t runtime;
+	uint64_t deadline;
+	uint64_t period;
+
+	// The entity's utilisation, in parts per million.
+	uint64_t utilisation;
+
+	// The current period: when it started, the absolute deadline, and the runtime left.
+	uint64_t period_start;
+	uint64_t abs_deadline;
+	int64_t remaining;
+
+	// When a throttled entity's budget will be replenished.
+	uint64_t replenish_at;
+
+	bool runnable;
+	bool throttled;
+
+	// The entity's position in whichever heap it is in, or -1 if it is not in one.
+	int heap_index;
+};
+
+/**
+ * A binary min-heap of deadline entities, ordered by the given key.
+ */
+template<uint64_t DeadlineEntity::*Key>
+class DeadlineHeap
+{
+public:
+	DeadlineHeap() : _count(0) { }
+
+	unsigned int count() const { return _count; }
+	DeadlineEntity *top() const { return _count ? _entries[0] : NULL; }
+
+	/**
+	 * Inserts an entity into the heap.
+	 */
+	void push(DeadlineEntity *de)
+	{
+		assert(_count < MAX_DEADLINE_ENTITIES);
+
+		_entries[_count] = de;
+		de->heap_index = _count++;
+		sift_up(de->heap_index);
+	}
+
+	/**
+	 * Removes an entity from anywhere in the heap.
+	 */
+	void remove(DeadlineEntity *de)
+	{
+		int index = de->heap_index;
+		assert(index >= 0 && (unsigned int)index < _count && _entries[index] == de);
+
+		de->heap_index = -1;
+		if ((unsigned int)index == --_count)
+		{
+			return;
+		}
+
+		// Move the last entry into the hole, and restore the heap property in whichever
+		// direction it has been broken.
+		_entries[index] = _entries[_count];
+		_entries[index]->heap_index = index;
+		sift_up(index);
+		sift_down(_entries[index]->heap_index);
+	}
+
+	/**
+	 * Updates the heap after an entity has been copied to a new location.
+	 */
+	void relocate(DeadlineEntity *from, DeadlineEntity *to)
+	{
+		assert(_entries[to->heap_index] == from);
+		_entries[to->heap_index] = to;
+	}
+
+private:
+	DeadlineEntity *_entries[MAX_DEADLINE_ENTITIES];
+	unsigned int _count;
+
+	bool less(unsigned int a, unsigned int b) const
+	{
+		return _entries[a]->*Key < _entries[b]->*Key;
+	}
+
+	void swap(unsigned int a, unsigned int b)
+	{
+		DeadlineEntity *tmp = _entries[a];
+		_entries[a] = _entries[b];
+		_entries[b] = tmp;
+
+		_entries[a]->heap_index = a;
+		_entries[b]->heap_index = b;
+	}
+
+	void sift_up(unsigned int index)
+	{
+		while (index > 0 && less(index, (index - 1) / 2))
+		{
+			swap(index, (index - 1) / 2);
+			index = (index - 1) / 2;
+		}
+	}
+
+	void sift_down(unsigned int index)
+	{
+		while (true)
+		{
+			unsigned int smallest = index;
+			unsigned int left = (index * 2) + 1;
+			unsigned int right = left + 1;
+
+			if (left < _count && less(left, smallest)) smallest = left;
+			if (right < _count && less(right, smallest)) smallest = right;
+			if (smallest == index) return;
+
+			swap(index, smallest);
+			index = smallest;
+		}
+	}
+};
+
+/**
+ * An earliest-deadline-first scheduling algorithm, with round-robin for best-effort entities.
+ */
+class EDFScheduler : public SchedulingAlgorithm
+{
+public:
+	EDFScheduler() : _nr_deadline_entities(0), _total_utilisation(0), _current(NULL), _current_start(0)
+	{
+	}
+
+	// The instance that is actually scheduling, for the parameter-setting functions to find.
+	// Every registered algorithm is constructed, but only the selected one is ever asked to
+	// schedule, so this is only set once that happens.
+	static EDFScheduler *instance;
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "edf"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+		instance = this;
+
+		DeadlineEntity *de = find(entity);
+		if (!de)
+		{
+			_best_effort.add_to_runqueue(entity);
+			return;
+		}
+
+		if (de->runnable)
+		{
+			return;
+		}
+
+		de->runnable = true;
+
+		// A throttled entity becomes eligible again when it is replenished.
+		if (de->throttled)
+		{
+			return;
+		}
+
+		// If the entity has missed its deadline, or used up its budget (e.g. whilst it was
+		// sleeping), it starts a new period now.
+		uint64_t now = sys.runtime().count();
+		if (now >= de->abs_deadline || de->remaining <= 0)
+		{
+			start_period(de, now);
+		}
+
+		_ready.push(de);
+		TRACE(TRACE_CAT_SCHED, TRACE_SCHED_ENQUEUE, _ready.count(), (uintptr_t)&entity, de->abs_deadline);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.  An entity that has
+	 * stopped (e.g. a thread that has exited) gives up its deadline parameters, so that its
+	 * reservation is freed, and is not inherited by an entity later created at its address.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		UniqueIRQLock l;
+
+		DeadlineEntity *de = find(entity);
+		if (!de)
+		{
+			_best_effort.remove_from_runqueue(entity);
+			return;
+		}
+
+		charge_current();
+
+		if (entity.state() == SchedulingEntityState::STOPPED)
+		{
+			release(de);
+			return;
+		}
+
+		de->runnable = false;
+		if (!de->throttled && de->heap_index >= 0)
+		{
+			_ready.remove(de);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The runnable deadline entity with the earliest deadline is chosen,
+	 * and only if there is none, is a best-effort entity chosen.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		instance = this;
+
+		charge_current();
+		replenish();
+
+		DeadlineEntity *de = _ready.top();
+		if (de)
+		{
+			_current = de;
+			_current_start = sys.runtime().count();
+			TRACE(TRACE_CAT_SCHED, TRACE_SCHED_PICK, _ready.count(), (uintptr_t)de->entity, de->abs_deadline);
+			return de->entity;
+		}
+
+		_current = NULL;
+		return _best_effort.pick_next_entity();
+	}
+
+	/**
+	 * Gives an entity deadline parameters, subject to admission control.  If the entity is
+	 * runnable, it is moved onto the deadline runqueue, and starts a new period now.
+	 */
+	bool set_deadline(SchedulingEntity& entity, uint64_t runtime, uint64_t deadline, uint64_t period)
+	{
+		if (runtime == 0 || runtime > deadline || deadline > period)
+		{
+			return false;
+		}
+
+		// Admit the entity only if the total density (runtime over deadline) stays within
+		// the limit, which is sufficient for every deadline to be met.
+		uint64_t utilisation = (runtime * 1000000) / deadline;
+
+		UniqueIRQLock l;
+
+		DeadlineEntity *de = find(entity);
+		uint64_t total = _total_utilisation - (de ? de->utilisation : 0) + utilisation;
+
+		if (total > MAX_DEADLINE_UTILISATION)
+		{
+			return false;
+		}
+
+		if (!de)
+		{
+			if (_nr_deadline_entities == MAX_DEADLINE_ENTITIES)
+			{
+				return false;
+			}
+
+			// A best-effort entity that is runnable (e.g. a thread setting its own parameters)
+			// is taken off the round-robin runqueue.
+			de = &_deadline_entities[_nr_deadline_entities++];
+			de->entity = &entity;
+			de->runnable = _best_effort.take_from_runqueue(entity);
+			de->throttled = false;
+			de->heap_index = -1;
+		}
+		else
+		{
+			// Take an already-admitted entity out of whichever heap it is in, as its key is
+			// about to change.  Bring its accounting up to date first, if it is running.
+			charge_current();
+			if (de == _current)
+			{
+				_current = NULL;
+			}
+
+			if (de->heap_index >= 0)
+			{
+				if (de->throttled)
+				{
+					_throttled.remove(de);
+				}
+				else
+				{
+					_ready.remove(de);
+				}
+			}
+
+			de->throttled = false;
+		}
+
+		_total_utilisation = total;
+
+		de->runtime = runtime;
+		de->deadline = deadline;
+		de->period = period;
+		de->utilisation = utilisation;
+
+		// Start a new period with the new parameters: now if the entity is runnable, otherwise
+		// when it is next added.
+		if (de->runnable)
+		{
+			start_period(de, sys.runtime().count());
+			_ready.push(de);
+		}
+		else
+		{
+			de->abs_deadline = 0;
+			de->remaining = 0;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Removes an entity's deadline parameters, moving it to the best-effort runqueue if it
+	 * is runnable.
+	 */
+	void clear_deadline(SchedulingEntity& entity)
+	{
+		UniqueIRQLock l;
+
+		DeadlineEntity *de = find(entity);
+		if (!de)
+		{
+			return;
+		}
+
+		if (de->runnable)
+		{
+			_best_effort.add_to_runqueue(entity);
+		}
+
+		release(de);
+	}
+
+private:
+	// Best-effort entities are scheduled round-robin.
+	RoundRobinScheduler _best_effort;
+
+	DeadlineEntity _deadline_entities[MAX_DEADLINE_ENTITIES];
+	unsigned int _nr_deadline_entities;
+	uint64_t _total_utilisation;
+
+	// Runnable, unthrottled entities, by absolute deadline.
+	DeadlineHeap<&DeadlineEntity::abs_deadline> _ready;
+
+	// Throttled entities, by the time at which their budget is replenished.
+	DeadlineHeap<&DeadlineEntity::replenish_at> _throttled;
+
+	// The running deadline entity (if any), and when it was last charged.
+	DeadlineEntity *_current;
+	uint64_t _current_start;
+
+	DeadlineEntity *find(SchedulingEntity& entity)
+	{
+		for (unsigned int i = 0; i < _nr_deadline_entities; i++)
+		{
+			if (_deadline_entities[i].entity == &entity)
+			{
+				return &_deadline_entities[i];
+			}
+		}
+
+		return NULL;
+	}
+
+	/**
+	 * Releases an entity's deadline state: takes it out of whichever heap it is in, returns
+	 * its utilisation, and frees its slot in the pool.
+	 */
+	void release(DeadlineEntity *de)
+	{
+		if (de == _current)
+		{
+			_current = NULL;
+		}
+
+		if (de->heap_index >= 0)
+		{
+			if (de->throttled)
+			{
+				_throttled.remove(de);
+			}
+			else
+			{
+				_ready.remove(de);
+			}
+		}
+
+		_total_utilisation -= de->utilisation;
+
+		// Keep the pool dense, by moving the last entry into the freed one.
+		DeadlineEntity *last = &_deadline_entities[--_nr_deadline_entities];
+		if (de != last)
+		{
+			*de = *last;
+			if (de->heap_index >= 0)
+			{
+				if (de->throttled)
+				{
+					_throttled.relocate(last, de);
+				}
+				else
+				{
+					_ready.relocate(last, de);
+				}
+			}
+
+			if (_current == last)
+			{
+				_current = de;
+			}
+		}
+	}
+
+	static void start_period(DeadlineEntity *de, uint64_t now)
+	{
+		de->period_start = now;
+		de->abs_deadline = now + de->deadline;
+		de->remaining = de->runtime;
+	}
+
+	/**
+	 * Charges the running deadline entity for the time it has run since it was last charged,
+	 * throttling it if it has used up its budget for this period.
+	 */
+	void charge_current()
+	{
+		if (!_current)
+		{
+			return;
+		}
+
+		DeadlineEntity *de = _current;
+		uint64_t now = sys.runtime().count();
+
+		de->remaining -= (int64_t)(now - _current_start);
+		_current_start = now;
+
+		if (de->remaining > 0 || de->throttled)
+		{
+			return;
+		}
+
+		_current = NULL;
+
+		if (de->heap_index >= 0)
+		{
+			_ready.remove(de);
+		}
+
+		de->throttled = true;
+		de->replenish_at = de->period_start + de->period;
+		_throttled.push(de);
+	}
+
+	/**
+	 * Replenishes the budget of every throttled entity whose next period has started.
+	 */
+	void replenish()
+	{
+		uint64_t now = sys.runtime().count();
+
+		DeadlineEntity *de;
+		while ((de = _throttled.top()) && de->replenish_at <= now)
+		{
+			_throttled.remove(de);
+			de->throttled = false;
+
+			// An overrun is carried into the next period; if the entity is so far behind that
+			// the period has already passed, it starts afresh from now.
+			int64_t overrun = de->remaining;
+			if (de->replenish_at + de->period <= now)
+			{
+				start_period(de, now);
+			}
+			else
+			{
+				start_period(de, de->replenish_at);
+				de->remaining += overrun;
+			}
+
+			if (de->remaining <= 0)
+			{
+				de->throttled = true;
+				de->replenish_at = de->period_start + de->period;
+				_throttled.push(de);
+			}
+			else if (de->runnable)
+			{
+				_ready.push(de);
+			}
+		}
+	}
+};
+
+EDFScheduler *EDFScheduler::instance;
+
+bool sched_set_deadline(SchedulingEntity &entity, uint64_t runtime_ns, uint64_t deadline_ns, uint64_t period_ns)
+{
+	if (!EDFScheduler::instance)
+	{
+		return false;
+	}
+
+	return EDFScheduler::instance->set_deadline(entity, runtime_ns, deadline_ns, period_ns);
+}
+
+void sched_clear_deadline(SchedulingEntity &entity)
+{
+	if (EDFScheduler::instance)
+	{
+		EDFScheduler::instance->clear_deadline(entity);
+	}
+}
+
+RegisterScheduler(EDFScheduler);
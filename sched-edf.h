@@ -0,0 +1,27 @@
+/*
+ * Earliest-Deadline-First Scheduling Algorithm
+ */
+#pragma once
+
+#include <infos/kernel/sched-entity.h>
+#include <infos/define.h>
+
+/**
+ * Gives a scheduling entity deadline (real-time) parameters, so that it is scheduled ahead of
+ * every best-effort entity.  Every period, the entity is guaranteed its runtime before its
+ * deadline (relative to the start of the period).  An entity that overruns its runtime is
+ * throttled until its next period.
+ * @param entity The scheduling entity.
+ * @param runtime_ns The CPU time the entity needs in each period.
+ * @param deadline_ns The time, from the start of each period, by which it needs it.
+ * @param period_ns The period.
+ * @return Returns TRUE if the entity was admitted, or FALSE if the parameters are invalid, or
+ * admitting the entity could overload the CPU.
+ */
+extern bool sched_set_deadline(infos::kernel::SchedulingEntity &entity, uint64_t runtime_ns, uint64_t deadline_ns, uint64_t period_ns);
+
+/**
+ * Removes the deadline parameters from a scheduling entity, returning it to best-effort scheduling.
+ * @param entity The scheduling entity.
+ */
+extern void sched_clear_deadline(infos::kernel::SchedulingEntity &entity);
@@ -6,67 +6,11 @@
 /*
  * STUDENT NUMBER: s
  */
-#include <infos/kernel/sched.h>
-#include <infos/kernel/thread.h>
-#include <infos/kernel/log.h>
-#include <infos/util/list.h>
-#include <infos/util/lock.h>
+#include "sched-rr.h"
 
 using namespace infos::kernel;
 using namespace infos::util;
 
-/**
- * A round-robin scheduling algorithm
- */
-class RoundRobinScheduler : public SchedulingAlgorithm
-{
-public:
-	/**
-	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
-	 */
-	const char* name() const override { return "rr"; }
-
-	/**
-	 * Called when a scheduling entity becomes eligible for running.
-	 * @param entity
-	 */
-	void add_to_runqueue(SchedulingEntity& entity) override
-	{
-		UniqueIRQLock l;
-		runqueue.enqueue(&entity);
-	}
-
-	/**
-	 * Called when a scheduling entity is no longer eligible for running.
-	 * @param entity
-	 */
-	void remove_from_runqueue(SchedulingEntity& entity) override
-	{
-		UniqueIRQLock l;
-		runqueue.remove(&entity);
-	}
-
-	/**
-	 * Called every time a scheduling event occurs, to cause the next eligible entity
-	 * to be chosen.  The next eligible entity might actually be the same entity, if
-	 * e.g. its timeslice has not expired.
-	 */
-	SchedulingEntity *pick_next_entity() override
-	{
-		if (runqueue.count() == 0) return NULL;
-		if (runqueue.count() == 1) return runqueue.first();
-
-		SchedulingEntity *entity = runqueue.first();
-		runqueue.remove(entity);
-		runqueue.enqueue(entity);
-		return entity;
-	}
-
-private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
-};
-
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
 
 RegisterScheduler(RoundRobinScheduler);
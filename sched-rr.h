@@ -0,0 +1,90 @@
+/*
+ * Round-robin Scheduling Algorithm
+ */
+#pragma once
+
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/list.h>
+#include <infos/util/lock.h>
+
+#include "trace.h"
+
+/**
+ * A round-robin scheduling algorithm
+ */
+class RoundRobinScheduler : public infos::kernel::SchedulingAlgorithm
+{
+public:
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "rr"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(infos::kernel::SchedulingEntity& entity) override
+	{
+		infos::util::UniqueIRQLock l;
+		runqueue.enqueue(&entity);
+		TRACE(TRACE_CAT_SCHED, TRACE_SCHED_ENQUEUE, runqueue.count(), (uintptr_t)&entity, 0);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(infos::kernel::SchedulingEntity& entity) override
+	{
+		infos::util::UniqueIRQLock l;
+		runqueue.remove(&entity);
+	}
+
+	/**
+	 * Removes a scheduling entity from the runqueue, if it is on it.
+	 * @param entity
+	 * @return Returns TRUE if the entity was on the runqueue.
+	 */
+	bool take_from_runqueue(infos::kernel::SchedulingEntity& entity)
+	{
+		infos::util::UniqueIRQLock l;
+
+		for (infos::kernel::SchedulingEntity *queued : runqueue)
+		{
+			if (queued == &entity)
+			{
+				runqueue.remove(&entity);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The next eligible entity might actually be the same entity, if
+	 * e.g. its timeslice has not expired.
+	 */
+	infos::kernel::SchedulingEntity *pick_next_entity() override
+	{
+		if (runqueue.count() == 0) return NULL;
+
+		infos::kernel::SchedulingEntity *entity = runqueue.first();
+		if (runqueue.count() > 1)
+		{
+			runqueue.remove(entity);
+			runqueue.enqueue(entity);
+		}
+
+		TRACE(TRACE_CAT_SCHED, TRACE_SCHED_PICK, runqueue.count(), (uintptr_t)entity, 0);
+		return entity;
+	}
+
+private:
+	// A list containing the current runqueue.
+	infos::util::List<infos::kernel::SchedulingEntity *> runqueue;
+};
@@ -0,0 +1,53 @@
+/*
+ * Sequence Counter
+ *
+ * A sequence counter protects data that is written rarely, by a single writer at a time, and
+ * read often.  The counter is odd whilst a write is in progress; readers copy the data, and
+ * retry if the counter was odd, or changed, during their copy.  Readers never block writers.
+ *
+ * The protected data must be accessed with (relaxed) atomic loads and stores.
+ */
+#pragma once
+
+#include <infos/define.h>
+
+/**
+ * Begins a read, waiting for any write in progress to finish.
+ * @return Returns the sequence number to pass to seqcount_read_retry().
+ */
+static inline uint32_t seqcount_read_begin(const uint32_t *seq)
+{
+	uint32_t start;
+	while ((start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+	{
+	}
+
+	return start;
+}
+
+/**
+ * Ends a read.
+ * @return Returns TRUE if a write happened during the read, and the read must be retried.
+ */
+static inline bool seqcount_read_retry(const uint32_t *seq, uint32_t start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+/**
+ * Begins a write.  Writers must be serialised with each other by the caller.
+ */
+static inline void seqcount_write_begin(uint32_t *seq)
+{
+	__atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Ends a write, publishing the new data to readers.
+ */
+static inline void seqcount_write_end(uint32_t *seq)
+{
+	__atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,86 @@
+/*
+ * Shared Time Page
+ *
+ * A read-only page, published by the CMOS RTC driver, from which user space can compute
+ * the current wall-clock time without making a system call.
+ */
+#pragma once
+
+#include <infos/define.h>
+
+#include "cycle-counter.h"
+#include "seqcount.h"
+
+/*
+ * The virtual address at which the time page is mapped (read-only) into every process.
+ */
+#define TIME_PAGE_VIRT_ADDR 0x7FFFFFFFE000ull
+
+/*
+ * The layout of the time page.  The kernel updates it once a second; the wall-clock time at
+ * any later point is base_epoch_ns + (((cycles - base_cycles) * mult) >> shift).  Each update
+ * starts from the time the previous parameters give, and corrects any error by adjusting
+ * mult, so the time never goes backwards.
+ */
+struct TimePage
+{
+	// Sequence counter (see seqcount.h) protecting the rest of the page.
+	uint32_t seq;
+
+	// Non-zero once the cycle counter has been calibrated, and the page can be used.
+	uint32_t valid;
+
+	// The wall-clock time (in nanoseconds since the UNIX epoch) at base_cycles.
+	int64_t base_epoch_ns;
+
+	// The value of the cycle counter at base_epoch_ns.
+	uint64_t base_cycles;
+
+	// The scale factor from cycles to nanoseconds.
+	uint32_t mult;
+	uint32_t shift;
+};
+
+/*
+ * The physical address of the time page, for the kernel to map into each process at
+ * TIME_PAGE_VIRT_ADDR.  Zero until the RTC driver has been initialised.
+ */
+extern phys_addr_t time_page_phys;
+
+/**
+ * Extrapolates the wall-clock time at the given cycle count, from the page's parameters.
+ * The caller must already hold a consistent view of the page.
+ */
+static inline int64_t time_page_extrapolate(const TimePage *page, uint64_t cycles)
+{
+	uint64_t base_cycles = __atomic_load_n(&page->base_cycles, __ATOMIC_RELAXED);
+	uint32_t mult = __atomic_load_n(&page->mult, __ATOMIC_RELAXED);
+	uint32_t shift = __atomic_load_n(&page->shift, __ATOMIC_RELAXED);
+
+	// The multiplication is done in 128 bits, so that it cannot overflow even if the kernel
+	// has not refreshed the page for a while.
+	return __atomic_load_n(&page->base_epoch_ns, __ATOMIC_RELAXED)
+		+ (int64_t)(((unsigned __int128)(cycles - base_cycles) * mult) >> shift);
+}
+
+/**
+ * Computes the current wall-clock time from the time page.
+ * @param page The time page.
+ * @param epoch_ns Populated with the current time, in nanoseconds since the UNIX epoch.
+ * @return Returns TRUE if the time page was valid, FALSE if the caller must fall back to
+ * asking the RTC device.
+ */
+static inline bool time_page_read(const TimePage *page, int64_t &epoch_ns)
+{
+	uint32_t seq;
+	uint32_t valid;
+
+	do
+	{
+		seq = seqcount_read_begin(&page->seq);
+		valid = __atomic_load_n(&page->valid, __ATOMIC_RELAXED);
+		epoch_ns = time_page_extrapolate(page, read_cycle_counter());
+	} while (seqcount_read_retry(&page->seq, seq));
+
+	return valid != 0;
+}
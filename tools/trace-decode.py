@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+Decodes a binary trace dump (the TRACE lines written to the log by trace_dump()) into
+one line per event.  Event numbers must be kept in sync with trace.h.
+
+Boot with e.g. trace.categories=sched,mm trace.dump-after=10 to have the kernel dump the
+buffers ten seconds after boot.
+
+Usage: trace-decode.py [--tsc-hz HZ] < kernel.log
+"""
+import argparse
+import re
+import sys
+
+EVENTS = {
+    1: ("sched.enqueue", "nr_running={arg0} entity={arg1:#x}"),
+    2: ("sched.pick", "nr_running={arg0} entity={arg1:#x}"),
+    3: ("mm.alloc", "order={arg0} pfn={arg1:#x}"),
+    4: ("mm.free", "order={arg0} pfn={arg1:#x}"),
+    5: ("mm.split", "order={arg0} pfn={arg1:#x}"),
+    6: ("mm.merge", "order={arg0} pfn={arg1:#x}"),
+    7: ("rtc.read", "epoch={arg1}"),
+}
+
+RECORD = re.compile(r"TRACE ([0-9a-f]{16}) ([0-9a-f]{16}) ([0-9a-f]{16}) ([0-9a-f]{16})")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--tsc-hz", type=float, help="cycle counter frequency, to print times in microseconds")
+    args = parser.parse_args()
+
+    records = []
+    for line in sys.stdin:
+        m = RECORD.search(line)
+        if not m:
+            continue
+
+        cycles, header, arg1, arg2 = (int(w, 16) for w in m.groups())
+        records.append((cycles, header & 0xFFFF, (header >> 16) & 0xFFFF, header >> 32, arg1, arg2))
+
+    if not records:
+        return
+
+    records.sort()
+    base = records[0][0]
+
+    for cycles, event, cpu, arg0, arg1, arg2 in records:
+        delta = cycles - base
+        when = "%14.3fus" % (delta * 1e6 / args.tsc_hz) if args.tsc_hz else "%16d" % delta
+
+        name, fmt = EVENTS.get(event, ("event-%d" % event, "arg0={arg0} arg1={arg1:#x}"))
+        detail = fmt.format(arg0=arg0, arg1=arg1, arg2=arg2)
+        if arg2:
+            detail += " arg2=%d" % arg2
+
+        print("%s cpu%d %-14s %s" % (when, cpu, name, detail))
+
+
+if __name__ == "__main__":
+    main()
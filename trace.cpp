@@ -0,0 +1,141 @@
+/*
+ * Binary Trace Buffer
+ */
+#include <infos/kernel/log.h>
+#include <infos/util/cmdline.h>
+#include <infos/util/lock.h>
+
+#include "percpu.h"
+#include "trace.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+
+// The number of records in each per-CPU ring.  Must be a power of two.
+#define TRACE_RING_SIZE 8192
+
+ComponentLog trace_log(syslog, "trace");
+
+uint32_t trace_categories;
+unsigned int trace_dump_after;
+
+/*
+ * A per-CPU ring of trace records.  Writers (including interrupt handlers that interrupt
+ * another writer) claim a slot by atomically incrementing head, so recording never locks.
+ * When the ring is full, the oldest records are overwritten.
+ */
+struct TraceBuffer
+{
+	TraceRecord records[TRACE_RING_SIZE];
+	uint64_t head;
+};
+
+static TraceBuffer trace_buffers[MAX_CPUS];
+
+void trace_record(uint16_t event, uint32_t arg0, uint64_t arg1, uint64_t arg2)
+{
+	unsigned int cpu = current_cpu();
+	TraceBuffer &buffer = trace_buffers[cpu];
+
+	uint64_t slot = __atomic_fetch_add(&buffer.head, 1, __ATOMIC_RELAXED);
+	TraceRecord &record = buffer.records[slot & (TRACE_RING_SIZE - 1)];
+
+	record.cycles = read_cycle_counter();
+	record.event = event;
+	record.cpu = cpu;
+	record.arg0 = arg0;
+	record.arg1 = arg1;
+	record.arg2 = arg2;
+}
+
+void trace_set_categories(uint32_t categories)
+{
+	__atomic_store_n(&trace_categories, categories, __ATOMIC_RELAXED);
+}
+
+/**
+ * Dumps every buffered record to the log, as raw hex, oldest first.  Interrupts are disabled
+ * for the duration, so no record can be half-written whilst it is being dumped.
+ */
+void trace_dump()
+{
+	UniqueIRQLock l;
+
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		TraceBuffer &buffer = trace_buffers[cpu];
+
+		uint64_t head = buffer.head;
+		uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+		trace_log.messagef(LogLevel::INFO, "TRACE BEGIN cpu=%u records=%lu lost=%lu", cpu, head - first, first);
+
+		for (uint64_t i = first; i < head; i++)
+		{
+			const uint64_t *words = (const uint64_t *)&buffer.records[i & (TRACE_RING_SIZE - 1)];
+			trace_log.messagef(LogLevel::INFO, "TRACE %016lx %016lx %016lx %016lx", words[0], words[1], words[2], words[3]);
+		}
+
+		trace_log.messagef(LogLevel::INFO, "TRACE END cpu=%u", cpu);
+	}
+}
+
+/*
+ * trace.categories=sched,mm,rtc enables the given categories at boot.
+ */
+RegisterCmdLineArgument(TraceCategories, "trace.categories")
+{
+	static const struct
+	{
+		const char *name;
+		uint32_t category;
+	} names[] = {
+		{ "sched", TRACE_CAT_SCHED },
+		{ "mm", TRACE_CAT_MM },
+		{ "rtc", TRACE_CAT_RTC },
+	};
+
+	uint32_t categories = 0;
+
+	while (*value)
+	{
+		for (unsigned int i = 0; i < ARRAY_SIZE(names); i++)
+		{
+			const char *n = names[i].name;
+			const char *v = value;
+
+			while (*n && *n == *v)
+			{
+				n++;
+				v++;
+			}
+
+			if (!*n && (*v == ',' || !*v))
+			{
+				categories |= names[i].category;
+			}
+		}
+
+		// Skip to the next name in the list.
+		while (*value && *value != ',') value++;
+		if (*value == ',') value++;
+	}
+
+	trace_set_categories(categories);
+}
+
+/*
+ * trace.dump-after=<seconds> stops tracing, and dumps the trace buffers, that many seconds
+ * after boot.
+ */
+RegisterCmdLineArgument(TraceDumpAfter, "trace.dump-after")
+{
+	unsigned int seconds = 0;
+
+	while (*value >= '0' && *value <= '9')
+	{
+		seconds = (seconds * 10) + (*value++ - '0');
+	}
+
+	trace_dump_after = seconds;
+}
@@ -0,0 +1,84 @@
+/*
+ * Binary Trace Buffer
+ *
+ * Static tracepoints record compact, fixed-size binary events into a per-CPU ring buffer.
+ * Each category of tracepoint can be switched on and off at runtime; a disabled tracepoint
+ * costs a single load and (predicted) branch.  The buffer is dumped in bulk, and decoded on
+ * the host with tools/trace-decode.py.
+ */
+#pragma once
+
+#include <infos/define.h>
+
+#include "cycle-counter.h"
+
+/*
+ * Tracepoint categories, which are enabled as a mask.
+ */
+#define TRACE_CAT_SCHED (1u << 0)
+#define TRACE_CAT_MM (1u << 1)
+#define TRACE_CAT_RTC (1u << 2)
+
+/*
+ * Trace events.  These numbers are part of the dump format, so must be kept in sync with
+ * tools/trace-decode.py.
+ */
+enum TraceEvent
+{
+	TRACE_SCHED_ENQUEUE = 1,	// arg0: runqueue length, arg1: entity
+	TRACE_SCHED_PICK = 2,		// arg0: runqueue length, arg1: entity
+	TRACE_MM_ALLOC = 3,		// arg0: order, arg1: pfn (or -1 if the allocation failed)
+	TRACE_MM_FREE = 4,		// arg0: order, arg1: pfn
+	TRACE_MM_SPLIT = 5,		// arg0: source order, arg1: pfn
+	TRACE_MM_MERGE = 6,		// arg0: source order, arg1: pfn
+	TRACE_RTC_READ = 7,		// arg1: epoch seconds
+};
+
+/*
+ * A trace record.  Records are 32 bytes, so that two fit in a cache line.
+ */
+struct TraceRecord
+{
+	uint64_t cycles;
+	uint16_t event;
+	uint16_t cpu;
+	uint32_t arg0;
+	uint64_t arg1;
+	uint64_t arg2;
+};
+
+static_assert(sizeof(TraceRecord) == 32, "trace records must be 32 bytes");
+
+/*
+ * The mask of enabled categories.
+ */
+extern uint32_t trace_categories;
+
+extern void trace_record(uint16_t event, uint32_t arg0, uint64_t arg1, uint64_t arg2);
+
+/*
+ * The number of seconds after boot at which tracing is stopped, and the trace buffers are
+ * dumped (trace.dump-after=<seconds>), or zero to never dump them automatically.  The
+ * countdown is driven by the CMOS RTC update interrupt.
+ */
+extern unsigned int trace_dump_after;
+
+/**
+ * Changes the mask of enabled categories at runtime.
+ */
+extern void trace_set_categories(uint32_t categories);
+
+/**
+ * Dumps the trace buffers to the log, for tools/trace-decode.py.  This formats a log line
+ * per record, so must not be called from interrupt context.
+ */
+extern void trace_dump();
+
+/*
+ * A static tracepoint.  The arguments are only evaluated if the category is enabled.
+ */
+#define TRACE(category, event, arg0, arg1, arg2) \
+	do { \
+		if (__builtin_expect(__atomic_load_n(&trace_categories, __ATOMIC_RELAXED) & (category), 0)) \
+			trace_record((event), (arg0), (arg1), (arg2)); \
+	} while (0)